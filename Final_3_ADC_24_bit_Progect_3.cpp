@@ -0,0 +1,638 @@
+/*
+В Final_3_ADC_24_bit_Progect_2.cpp скорость SPI была поднята до 2 MHz "на глаз".
+Узнать заранее, какая частота надежно работает на конкретной плате и кабеле, нельзя,
+поэтому в этой версии добавлен режим самопроверки.
+
+CS1237 на самом деле не SPI-устройство: у него двухпроводный интерфейс SCLK + DRDY/DOUT,
+а команды записи (0x65) и чтения (0x56) конфигурации - 7-битные и передаются только после
+29 тактов чтения данных. Аппаратным SPI такой кадр не сформировать, поэтому здесь протокол
+реализован программно (bit-bang): SCLK общий для всех АЦП, у каждого АЦП своя линия DOUT,
+которая на время передачи команды переключается на выход.
+
+Самопроверка:
+- перебираем частоты SCLK из таблицы и на каждой многократно записываем и считываем регистр
+  конфигурации, сверяя ответ каждого АЦП по его собственной линии DOUT;
+- выбираем максимальную частоту без ошибок, уменьшаем ее на запас надежности, проверяем
+  выбранную частоту и только после этого сохраняем ее во flash;
+- после каждой проверки возвращаем рабочую конфигурацию и отбрасываем первые преобразования;
+- периодически перепроверяем выбранную частоту и при повторных ошибках повторяем перебор.
+Для проверки логики перебора без железа есть эмулятор шины (SPI_EMULATION = 1),
+который вносит битовые ошибки при частоте выше заданного порога.
+*/
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/stdio_usb.h"
+#include "hardware/clocks.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+// Определяем пины: общий SCLK и отдельная линия DRDY/DOUT для каждого АЦП
+#define ADC_SCLK  13
+#define ADC_DOUT1 14  // DOUT первого АЦП
+#define ADC_DOUT2 15  // DOUT второго АЦП
+#define ADC_DOUT3 16  // DOUT третьего АЦП
+
+#define ADC_COUNT 3
+#define ADC_DOUT_MASK (((1u << ADC_COUNT) - 1) << ADC_DOUT1)  // Линии DOUT идут подряд
+
+// Настройки АЦП
+#define ADC_CONFIG 0x0C                 // Рабочая конфигурация: канал A, PGA 128, 10 Hz
+#define ADC_SETTLE_CONVERSIONS 4        // Сколько преобразований отбросить после смены конфигурации
+// После смены конфигурации или выхода из сна фильтру на 10 Hz нужно несколько периодов по 100 мс,
+// плюс разброс внутреннего генератора CS1237, поэтому ждем с большим запасом
+#define ADC_DRDY_TIMEOUT_US 1500000     // Максимальное ожидание готовности данных
+#define ADC_SYNC_HIGH_US 200            // SCLK в высоком уровне > 100 мкс усыпляет все АЦП одновременно
+#define CONFIG_FRAME_CLOCKS 46          // Тактов SCLK в кадре обращения к конфигурации
+#define READ_INTERVAL_MS 1000           // Интервал чтения в миллисекундах
+#define USB_CONNECT_TIMEOUT_MS 5000     // Сколько ждать подключения терминала перед самопроверкой
+
+// Настройки самопроверки
+#define SELFTEST_ITERATIONS 64          // Число циклов запись/чтение конфигурации за один проход
+#define SELFTEST_ATTEMPTS 3             // Частота негодна только после стольких неудачных проходов подряд
+#define SELFTEST_MARGIN_PERCENT 75      // Итоговая частота = 75% от максимальной рабочей
+#define REVALIDATE_INTERVAL_MS 60000    // Интервал перепроверки выбранной частоты
+#define CLOCK_SAVE_MIN_INTERVAL_MS 3600000  // Не перезаписывать flash чаще раза в час
+
+// 1 - работать с эмулятором шины вместо настоящих АЦП
+#define SPI_EMULATION 0
+#define EMU_ERROR_THRESHOLD_HZ 800000   // Выше этой частоты эмулятор вносит битовые ошибки
+
+// Команды для CS1237 (7 бит)
+#define CMD_WRITE_CONFIG 0x65  // Запись регистра конфигурации
+#define CMD_READ_CONFIG  0x56  // Чтение регистра конфигурации
+
+// Известные значения конфигурации для проверки. Биты канала всегда 00 (канал A),
+// чтобы не выбрать зарезервированный канал или закороченный вход. Скорость всегда 640 Hz:
+// период 1.56 мс, а кадр из 46 тактов на самой низкой частоте таблицы (50 kHz) занимает 0.92 мс,
+// то есть целиком помещается между обновлениями данных. Биты 6, 3, 2 принимают оба значения.
+static const uint8_t selftest_patterns[] = {0x2C, 0x60, 0x64, 0x28};
+
+// Таблица перебираемых частот SCLK (по возрастанию)
+static const uint32_t selftest_rates[] = {
+    50000, 100000, 200000, 300000, 500000, 700000, 1000000, 1500000, 2000000
+};
+
+// Хранение выбранной частоты в последнем секторе flash
+#define CLOCK_STORE_MAGIC  0x53504942u  // "SPIB"
+#define CLOCK_STORE_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t clock_hz;
+    uint32_t clock_hz_inv;  // ~clock_hz, защита от частично записанного сектора
+} clock_store_t;
+
+// Шина к АЦП: настоящие CS1237 или эмулятор с одинаковым интерфейсом
+typedef struct adc_bus {
+    uint32_t (*set_clock)(struct adc_bus *bus, uint32_t hz);
+    uint32_t (*measured_clock)(struct adc_bus *bus);             // Частота на линии с момента set_clock
+    void (*sync)(struct adc_bus *bus);                           // Одновременный перезапуск всех АЦП
+    bool (*read_data)(struct adc_bus *bus, uint32_t *values);    // 24 бита с каждого АЦП
+    bool (*write_config)(struct adc_bus *bus, uint8_t config);   // Одно значение во все АЦП
+    bool (*read_config)(struct adc_bus *bus, uint8_t *configs);  // Ответ каждого АЦП отдельно
+    void *ctx;
+} adc_bus_t;
+
+// ---------- Настоящие CS1237 (bit-bang) ----------
+
+typedef struct {
+    uint32_t half_period_cycles;
+    uint32_t overhead_cycles;       // Накладные расходы bit-bang на один такт, по замерам кадров
+    uint64_t frame_us;              // Суммарное время кадров конфигурации на текущей частоте
+    uint32_t frame_clocks;          // Суммарное число тактов в этих кадрах
+} hw_state_t;
+
+static void hw_init(void) {
+    gpio_init(ADC_SCLK);
+    gpio_set_dir(ADC_SCLK, GPIO_OUT);
+    gpio_put(ADC_SCLK, 0);  // Долгий высокий уровень SCLK переводит CS1237 в сон
+
+    gpio_init_mask(ADC_DOUT_MASK);
+    gpio_set_dir_in_masked(ADC_DOUT_MASK);
+}
+
+// Один такт SCLK. Возвращает состояние линий DOUT (бит i - АЦП i), считанное при высоком SCLK
+static uint32_t hw_clock(hw_state_t *hw) {
+    gpio_put(ADC_SCLK, 1);
+    busy_wait_at_least_cycles(hw->half_period_cycles);
+    uint32_t lines = (gpio_get_all() & ADC_DOUT_MASK) >> ADC_DOUT1;
+    gpio_put(ADC_SCLK, 0);
+    busy_wait_at_least_cycles(hw->half_period_cycles);
+    return lines;
+}
+
+// Ждем, пока все АЦП опустят DRDY/DOUT (данные готовы)
+static bool hw_wait_ready(void) {
+    absolute_time_t deadline = make_timeout_time_us(ADC_DRDY_TIMEOUT_US);
+    while (gpio_get_all() & ADC_DOUT_MASK) {
+        if (time_reached(deadline)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Выставляет полупериод так, чтобы с учетом измеренных накладных расходов на линии была
+// частота hz. Возвращает ожидаемую частоту на линии.
+static uint32_t hw_set_clock(adc_bus_t *bus, uint32_t hz) {
+    hw_state_t *hw = (hw_state_t *)bus->ctx;
+    uint32_t sys_hz = clock_get_hz(clk_sys);
+
+    // Накладные расходы уточняем только по достаточно длинному замеру
+    if (hw->frame_us >= 500) {
+        uint32_t period_cycles = (uint32_t)(hw->frame_us * (sys_hz / 1000000) / hw->frame_clocks);
+        uint32_t busy_cycles = 2 * hw->half_period_cycles;
+        hw->overhead_cycles = period_cycles > busy_cycles ? period_cycles - busy_cycles : 0;
+    }
+    hw->frame_us = 0;
+    hw->frame_clocks = 0;
+
+    uint32_t period_cycles = sys_hz / hz;
+    hw->half_period_cycles = period_cycles > hw->overhead_cycles + 2 ? (period_cycles - hw->overhead_cycles) / 2 : 1;
+    return sys_hz / (2 * hw->half_period_cycles + hw->overhead_cycles);
+}
+
+static uint32_t hw_measured_clock(adc_bus_t *bus) {
+    hw_state_t *hw = (hw_state_t *)bus->ctx;
+    if (hw->frame_us == 0) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)hw->frame_clocks * 1000000 / hw->frame_us);
+}
+
+static void hw_sync(adc_bus_t *bus) {
+    (void)bus;
+    gpio_put(ADC_SCLK, 1);
+    busy_wait_us(ADC_SYNC_HIGH_US);
+    gpio_put(ADC_SCLK, 0);  // Все АЦП просыпаются и начинают преобразование одновременно
+}
+
+static bool hw_read_data(adc_bus_t *bus, uint32_t *values) {
+    hw_state_t *hw = (hw_state_t *)bus->ctx;
+
+    if (!hw_wait_ready()) {
+        return false;
+    }
+    for (int i = 0; i < ADC_COUNT; i++) {
+        values[i] = 0;
+    }
+    // Такты 1-24: данные, старшим битом вперед
+    for (int bit = 0; bit < 24; bit++) {
+        uint32_t lines = hw_clock(hw);
+        for (int i = 0; i < ADC_COUNT; i++) {
+            values[i] = (values[i] << 1) | ((lines >> i) & 1);
+        }
+    }
+    // Такты 25-27: биты состояния и подъем DOUT
+    for (int i = 0; i < 3; i++) {
+        hw_clock(hw);
+    }
+    return true;
+}
+
+// Кадр обращения к регистру конфигурации: 29 тактов (данные, биты состояния, смена направления),
+// 7-битная команда, такт смены направления, 8 бит конфигурации, завершающий такт.
+// Если read_values == NULL, записываем write_value, иначе читаем ответ каждого АЦП.
+// Длительность кадра копится для измерения реальной частоты SCLK.
+static bool hw_config_frame(hw_state_t *hw, uint8_t cmd, uint8_t write_value, uint8_t *read_values) {
+    if (!hw_wait_ready()) {
+        return false;
+    }
+    uint64_t start_us = time_us_64();
+
+    for (int i = 0; i < 29; i++) {
+        hw_clock(hw);
+    }
+
+    // Такты 30-36: команда, DOUT всех АЦП управляется микроконтроллером
+    gpio_set_dir_out_masked(ADC_DOUT_MASK);
+    for (int bit = 6; bit >= 0; bit--) {
+        gpio_put_masked(ADC_DOUT_MASK, ((cmd >> bit) & 1) ? ADC_DOUT_MASK : 0);
+        hw_clock(hw);
+    }
+
+    // Такт 37: при чтении линия возвращается АЦП
+    if (read_values != NULL) {
+        gpio_set_dir_in_masked(ADC_DOUT_MASK);
+        for (int i = 0; i < ADC_COUNT; i++) {
+            read_values[i] = 0;
+        }
+    }
+    hw_clock(hw);
+
+    // Такты 38-45: значение конфигурации
+    for (int bit = 7; bit >= 0; bit--) {
+        if (read_values == NULL) {
+            gpio_put_masked(ADC_DOUT_MASK, ((write_value >> bit) & 1) ? ADC_DOUT_MASK : 0);
+        }
+        uint32_t lines = hw_clock(hw);
+        if (read_values != NULL) {
+            for (int i = 0; i < ADC_COUNT; i++) {
+                read_values[i] = (uint8_t)((read_values[i] << 1) | ((lines >> i) & 1));
+            }
+        }
+    }
+
+    // Такт 46: линия снова у АЦП
+    gpio_set_dir_in_masked(ADC_DOUT_MASK);
+    hw_clock(hw);
+
+    hw->frame_us += time_us_64() - start_us;
+    hw->frame_clocks += CONFIG_FRAME_CLOCKS;
+    return true;
+}
+
+static bool hw_write_config(adc_bus_t *bus, uint8_t config) {
+    return hw_config_frame((hw_state_t *)bus->ctx, CMD_WRITE_CONFIG, config, NULL);
+}
+
+static bool hw_read_config(adc_bus_t *bus, uint8_t *configs) {
+    return hw_config_frame((hw_state_t *)bus->ctx, CMD_READ_CONFIG, 0, configs);
+}
+
+// ---------- Эмулятор шины ----------
+
+typedef struct {
+    uint32_t clock_hz;
+    uint32_t threshold_hz;
+    uint32_t rng;                   // Состояние генератора псевдослучайных чисел
+    uint8_t config[ADC_COUNT];
+    uint32_t sample[ADC_COUNT];
+} emu_state_t;
+
+static uint32_t emu_rand(emu_state_t *emu) {
+    // xorshift32
+    emu->rng ^= emu->rng << 13;
+    emu->rng ^= emu->rng >> 17;
+    emu->rng ^= emu->rng << 5;
+    return emu->rng;
+}
+
+// Вносит битовые ошибки, вероятность которых растет с превышением порога частоты
+static uint32_t emu_corrupt(emu_state_t *emu, uint32_t value, int bits) {
+    if (emu->clock_hz <= emu->threshold_hz) {
+        return value;
+    }
+    uint32_t error_ppm = (emu->clock_hz - emu->threshold_hz) / 10;  // 100 kHz сверх порога -> 1% на бит
+    for (int bit = 0; bit < bits; bit++) {
+        if (emu_rand(emu) % 1000000 < error_ppm) {
+            value ^= 1u << bit;
+        }
+    }
+    return value;
+}
+
+static uint32_t emu_set_clock(adc_bus_t *bus, uint32_t hz) {
+    ((emu_state_t *)bus->ctx)->clock_hz = hz;
+    return hz;
+}
+
+static uint32_t emu_measured_clock(adc_bus_t *bus) {
+    return ((emu_state_t *)bus->ctx)->clock_hz;
+}
+
+static void emu_sync(adc_bus_t *bus) {
+    (void)bus;  // Эмулятор не моделирует фазы преобразований
+}
+
+static bool emu_read_data(adc_bus_t *bus, uint32_t *values) {
+    emu_state_t *emu = (emu_state_t *)bus->ctx;
+    for (int i = 0; i < ADC_COUNT; i++) {
+        // Медленно меняющийся сигнал, свой для каждого АЦП
+        emu->sample[i] = (emu->sample[i] + 1000 * (i + 1)) & 0xFFFFFF;
+        values[i] = emu_corrupt(emu, emu->sample[i], 24);
+    }
+    return true;
+}
+
+static bool emu_write_config(adc_bus_t *bus, uint8_t config) {
+    emu_state_t *emu = (emu_state_t *)bus->ctx;
+    for (int i = 0; i < ADC_COUNT; i++) {
+        // Искаженную команду АЦП не распознает и конфигурацию не меняет
+        if (emu_corrupt(emu, CMD_WRITE_CONFIG, 7) == CMD_WRITE_CONFIG) {
+            emu->config[i] = (uint8_t)emu_corrupt(emu, config, 8);
+        }
+    }
+    return true;
+}
+
+static bool emu_read_config(adc_bus_t *bus, uint8_t *configs) {
+    emu_state_t *emu = (emu_state_t *)bus->ctx;
+    for (int i = 0; i < ADC_COUNT; i++) {
+        if (emu_corrupt(emu, CMD_READ_CONFIG, 7) == CMD_READ_CONFIG) {
+            configs[i] = (uint8_t)emu_corrupt(emu, emu->config[i], 8);
+        } else {
+            configs[i] = 0xFF;  // Команда не распознана, линия остается в высоком уровне
+        }
+    }
+    return true;
+}
+
+// ---------- Работа с АЦП ----------
+
+// Функция для чтения данных со всех АЦП
+bool read_all_adcs(adc_bus_t *bus, uint32_t *adc_values) {
+    return bus->read_data(bus, adc_values);
+}
+
+// Синхронизирует АЦП, записывает конфигурацию во все АЦП и сверяет считанное значение.
+// Возвращает количество несовпадений.
+static int check_config_readback(adc_bus_t *bus, uint8_t config) {
+    uint8_t values[ADC_COUNT];
+    int errors = 0;
+
+    // Без синхронизации кадр может начаться, когда у одного из АЦП уже подходит новое преобразование
+    bus->sync(bus);
+    if (!bus->write_config(bus, config) || !bus->read_config(bus, values)) {
+        return ADC_COUNT;
+    }
+    for (int i = 0; i < ADC_COUNT; i++) {
+        if (values[i] != config) {
+            errors++;
+        }
+    }
+    return errors;
+}
+
+// Один проход проверки: SELFTEST_ITERATIONS циклов по всем шаблонам
+static bool validate_pass(adc_bus_t *bus) {
+    int n_patterns = sizeof(selftest_patterns) / sizeof(selftest_patterns[0]);
+    for (int i = 0; i < SELFTEST_ITERATIONS; i++) {
+        if (check_config_readback(bus, selftest_patterns[i % n_patterns]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Проверяет текущую частоту шины. Одно правило и для перебора, и для перепроверки:
+// частота негодна только после SELFTEST_ATTEMPTS неудачных проходов подряд.
+static bool validate_current_rate(adc_bus_t *bus) {
+    for (int attempt = 0; attempt < SELFTEST_ATTEMPTS; attempt++) {
+        if (validate_pass(bus)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Возвращает рабочую конфигурацию и отбрасывает первые преобразования после ее смены
+static bool restore_operating_config(adc_bus_t *bus) {
+    uint32_t values[ADC_COUNT];
+
+    if (check_config_readback(bus, ADC_CONFIG) != 0) {
+        return false;
+    }
+    for (int i = 0; i < ADC_SETTLE_CONVERSIONS; i++) {
+        if (!bus->read_data(bus, values)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Полная проверка текущей частоты. Рабочая конфигурация возвращается в любом случае,
+// частота считается годной, только если это тоже удалось.
+static bool selftest_rate(adc_bus_t *bus) {
+    bool ok = validate_current_rate(bus);
+    return restore_operating_config(bus) && ok;
+}
+
+// Перебирает частоты по возрастанию до первой ошибки, затем берет максимальную рабочую
+// с запасом надежности. Если она не проходит проверку, спускается по таблице.
+// Все частоты в логе и в результате - измеренные на линии.
+// Возвращает false, если ни одна частота не прошла проверку.
+static bool sweep_clock(adc_bus_t *bus, uint32_t *chosen) {
+    int n_rates = sizeof(selftest_rates) / sizeof(selftest_rates[0]);
+    int max_ok = -1;
+    uint32_t max_ok_hz = 0;
+
+    for (int i = 0; i < n_rates; i++) {
+        bus->set_clock(bus, selftest_rates[i]);
+        bool ok = validate_current_rate(bus);
+        uint32_t actual = bus->measured_clock(bus);
+        printf("# selftest %lu Hz (measured %lu Hz): %s\n", selftest_rates[i], actual, ok ? "OK" : "FAIL");
+        if (!ok) {
+            break;  // Выше первой ошибки частоты считаем ненадежными
+        }
+        max_ok = i;
+        max_ok_hz = actual;
+    }
+
+    if (max_ok >= 0) {
+        uint32_t target = (uint32_t)((uint64_t)max_ok_hz * SELFTEST_MARGIN_PERCENT / 100);
+        int next = max_ok;
+        while (true) {
+            bus->set_clock(bus, target);
+            bool ok = selftest_rate(bus);
+            uint32_t actual = bus->measured_clock(bus);
+            if (ok) {
+                printf("# selftest: max %lu Hz, chosen %lu Hz\n", max_ok_hz, actual);
+                *chosen = actual;
+                return true;
+            }
+            printf("# selftest %lu Hz (measured %lu Hz): FAIL\n", target, actual);
+            while (next >= 0 && selftest_rates[next] >= target) {
+                next--;
+            }
+            if (next < 0) {
+                break;
+            }
+            target = selftest_rates[next];
+        }
+    }
+
+    // Ни одна частота не прошла: все равно возвращаем рабочую конфигурацию на самой низкой
+    bus->set_clock(bus, selftest_rates[0]);
+    if (!restore_operating_config(bus)) {
+        printf("# selftest: operating config not restored\n");
+    }
+    printf("# selftest: FAILED, no reliable clock rate, acquisition stopped\n");
+    return false;
+}
+
+// ---------- Хранение частоты во flash ----------
+
+#if SPI_EMULATION
+// Результат эмулятора не должен попасть во flash, где его прочитает сборка для платы
+static uint32_t load_stored_clock(void) {
+    return 0;
+}
+
+static void save_clock(uint32_t hz) {
+    (void)hz;
+}
+#else
+static uint32_t load_stored_clock(void) {
+    const clock_store_t *store = (const clock_store_t *)(XIP_BASE + CLOCK_STORE_OFFSET);
+    if (store->magic != CLOCK_STORE_MAGIC || store->clock_hz != ~store->clock_hz_inv) {
+        return 0;
+    }
+    return store->clock_hz;
+}
+
+static void save_clock(uint32_t hz) {
+    static bool saved = false;
+    static absolute_time_t last_save_time;
+
+    if (load_stored_clock() == hz) {
+        return;  // Не расходуем ресурс flash зря
+    }
+    if (saved && absolute_time_diff_us(last_save_time, get_absolute_time()) < CLOCK_SAVE_MIN_INTERVAL_MS * 1000LL) {
+        printf("# selftest: %lu Hz not saved, flash was written recently\n", hz);
+        return;
+    }
+
+    uint8_t page[FLASH_PAGE_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    clock_store_t store = {CLOCK_STORE_MAGIC, hz, ~hz};
+    memcpy(page, &store, sizeof(store));
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    flash_range_erase(CLOCK_STORE_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(CLOCK_STORE_OFFSET, page, FLASH_PAGE_SIZE);
+    restore_interrupts(interrupts);
+
+    saved = true;
+    last_save_time = get_absolute_time();
+}
+#endif
+
+// Берет сохраненную частоту, если она проходит проверку, иначе делает полный перебор.
+// Во flash попадает только частота, прошедшая проверку.
+static bool select_clock(adc_bus_t *bus, uint32_t *chosen) {
+    uint32_t stored = load_stored_clock();
+    if (stored != 0) {
+        // Кадр на самой низкой частоте измеряет накладные расходы bit-bang,
+        // чтобы сохраненная частота выставилась на линии точно
+        uint8_t configs[ADC_COUNT];
+        bus->set_clock(bus, selftest_rates[0]);
+        bus->read_config(bus, configs);
+
+        bus->set_clock(bus, stored);
+        bool ok = selftest_rate(bus);
+        uint32_t actual = bus->measured_clock(bus);
+        if (ok) {
+            printf("# selftest: stored rate %lu Hz OK (measured %lu Hz)\n", stored, actual);
+            *chosen = actual;
+            return true;
+        }
+        printf("# selftest: stored rate %lu Hz FAIL (measured %lu Hz)\n", stored, actual);
+    }
+
+    if (!sweep_clock(bus, chosen)) {
+        return false;
+    }
+    save_clock(*chosen);
+    return true;
+}
+
+int main() {
+    // Инициализация
+    stdio_init_all();  // Инициализация USB (Serial)
+
+    // Ждем терминал, иначе строки самопроверки уйдут до подключения и потеряются
+    absolute_time_t usb_deadline = make_timeout_time_ms(USB_CONNECT_TIMEOUT_MS);
+    while (!stdio_usb_connected() && !time_reached(usb_deadline)) {
+        sleep_ms(10);
+    }
+
+#if SPI_EMULATION
+    static emu_state_t emu = {0};
+    emu.threshold_hz = EMU_ERROR_THRESHOLD_HZ;
+    emu.rng = 0x12345678;
+    adc_bus_t bus = {emu_set_clock, emu_measured_clock, emu_sync, emu_read_data, emu_write_config, emu_read_config, &emu};
+#else
+    // Настройка GPIO для SCLK и линий DOUT
+    hw_init();
+    static hw_state_t hw;
+    adc_bus_t bus = {hw_set_clock, hw_measured_clock, hw_sync, hw_read_data, hw_write_config, hw_read_config, &hw};
+#endif
+
+    // Подбор частоты SCLK
+    uint32_t clock_hz = 0;
+    bool tuned = select_clock(&bus, &clock_hz);
+
+    // Таймеры для контроля времени
+    absolute_time_t last_read_time = get_absolute_time();
+    absolute_time_t last_check_time = last_read_time;
+
+    // Записываем заголовок CSV
+    printf("Time,ADC1,ADC2,ADC3\n");
+
+    while (true) {
+        // Получаем текущее время
+        absolute_time_t current_time = get_absolute_time();
+
+        // Периодическая перепроверка; без рабочей частоты - повторный перебор
+        if (absolute_time_diff_us(last_check_time, current_time) >= (REVALIDATE_INTERVAL_MS * 1000LL)) {
+            last_check_time = current_time;
+            if (tuned && !selftest_rate(&bus)) {
+                printf("# selftest: %lu Hz failed revalidation\n", clock_hz);
+                tuned = false;
+            }
+            if (!tuned) {
+                tuned = sweep_clock(&bus, &clock_hz);
+                if (tuned) {
+                    save_clock(clock_hz);
+                }
+            }
+        }
+
+        // Без проверенной частоты данные не выводим
+        if (!tuned) {
+            continue;
+        }
+
+        // Проверяем, прошло ли нужное количество времени
+        if (absolute_time_diff_us(last_read_time, current_time) >= (READ_INTERVAL_MS * 1000)) {
+            // Обновляем время последнего чтения
+            last_read_time = current_time;
+
+            // Чтение значений с АЦП
+            uint32_t adc_values[ADC_COUNT];
+            if (!read_all_adcs(&bus, adc_values)) {
+                printf("# read timeout\n");
+                continue;
+            }
+
+            // Получаем текущее время в миллисекундах с начала работы
+            uint64_t elapsed_time = to_ms_since_boot(current_time);
+
+            // Форматируем выход в CSV
+            printf("%llu,%lu,%lu,%lu\n", elapsed_time, adc_values[0], adc_values[1], adc_values[2]);
+        }
+    }
+
+    return 0;
+}
+
+/*
+Главные изменения:
+Протокол CS1237: аппаратный SPI заменен программной реализацией двухпроводного интерфейса. Команды конфигурации
+передаются после 29 тактов чтения данных, ответ каждого АЦП читается с его собственной линии DOUT.
+Перед каждой проверкой АЦП синхронизируются: SCLK держится в высоком уровне дольше 100 мкс и отпускается.
+Самопроверка частоты: при старте частоты из selftest_rates перебираются по возрастанию, на каждой SELFTEST_ITERATIONS раз
+записывается и считывается регистр конфигурации всех трех АЦП. Частота негодна только после SELFTEST_ATTEMPTS неудачных
+проходов подряд - это правило одинаково для перебора и для периодической перепроверки. Перебор останавливается на первой
+негодной частоте.
+Измерение частоты: длительность кадров конфигурации замеряется по time_us_64, в лог, в расчет запаса и во flash идет
+измеренная частота на линии. Измеренные накладные расходы bit-bang учитываются при выставлении следующей частоты.
+Запас надежности: итоговая частота - SELFTEST_MARGIN_PERCENT процентов от максимальной рабочей. Если она не проходит
+проверку, берется следующая частота ниже по таблице. Если не проходит ни одна, данные не выводятся, перебор повторяется
+каждые REVALIDATE_INTERVAL_MS.
+Рабочая конфигурация: после каждой проверки, в том числе после неудачного перебора, в АЦП записывается ADC_CONFIG,
+ее чтение сверяется, первые ADC_SETTLE_CONVERSIONS преобразований отбрасываются.
+Хранение: во flash сохраняется только проверенная частота, не чаще раза в CLOCK_SAVE_MIN_INTERVAL_MS. При следующем
+запуске она только перепроверяется, без полного перебора.
+Эмулятор шины: при SPI_EMULATION = 1 вместо АЦП используется эмулятор, который вносит битовые ошибки выше
+EMU_ERROR_THRESHOLD_HZ. В этом режиме flash не читается и не записывается. Результат перебора виден в строках,
+начинающихся с '#', которые легко отделить от CSV.
+Вывод: перед самопроверкой программа до USB_CONNECT_TIMEOUT_MS ждет подключения терминала по USB.
+
+Сборка: кроме pico_stdlib нужна библиотека hardware_flash и вывод через USB, например в CMakeLists.txt:
+    target_link_libraries(Final_3_ADC_24_bit_Progect_3 pico_stdlib hardware_flash)
+    pico_enable_stdio_usb(Final_3_ADC_24_bit_Progect_3 1)
+Сборка в этом репозитории не проверялась: CMakeLists.txt и pico-sdk в нем нет.
+*/